@@ -8,48 +8,351 @@
 #include "Agency.h"
 #include <iostream>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
 #include <iomanip>
+#include <limits>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <utility>
 #include <vector>
 #include <unordered_map>
 
-struct Agency::Impl {
-    // Store of all agents working at agency.
-    std::unordered_map<Agent::AgentId, std::shared_ptr<Agent>> m_agents;
+namespace {
 
-    // Store of all commission plans created at agency.
-    std::unordered_map<CommissionPlan::CommPlanId, std::shared_ptr<CommissionPlan>> m_plans;
+// Maximum number of snapshots that may be pinned on one agency without
+// taking the writer lock.
+constexpr std::size_t kMaxReaders = 64;
+
+// Slot of a snapshot pinned while every reader slot was busy.
+constexpr std::size_t kOverflowSlot = kMaxReaders;
+
+// Reader slot value when the slot does not pin any epoch.
+constexpr std::uint64_t kIdleSlot = 0;
+
+// Chain log index marking the end of a policy's agent chain.
+constexpr std::uint32_t kNoEntry = std::numeric_limits<std::uint32_t>::max();
+
+// Replace a shared table with a private copy that can be modified
+// without disturbing readers of the previous state.
+template <typename Table>
+Table& copyOnWrite(std::shared_ptr<const Table>& table, std::pmr::memory_resource* resource) {
+    auto copy = std::allocate_shared<Table>(std::pmr::polymorphic_allocator<Table>(resource), *table);
+    table = copy;
+    return *copy;
+}
+
+// Estimated bytes of an object created by allocate_shared, including the
+// control block holding its counts and allocator.
+template <typename T>
+constexpr std::size_t sharedBytes() {
+    return sizeof(T) + 2 * sizeof(void*) + sizeof(std::pmr::polymorphic_allocator<T>);
+}
+
+// Estimated bytes of the nodes of a node based hash table.
+template <typename Table>
+std::size_t nodeBytes(const Table& table) {
+    return table.size() * (sizeof(void*) + sizeof(typename Table::value_type));
+}
+
+// Estimated bytes of a shared hash table object and its bucket array.
+template <typename Table>
+std::size_t bucketBytes(const Table& table) {
+    return sharedBytes<Table>() + table.bucket_count() * sizeof(void*);
+}
+
+// Estimated bytes freed with a retired table: its nodes and buckets, and
+// the objects no other table still shares.
+template <typename Table>
+std::size_t retiredTableBytes(const Table& table) {
+    std::size_t bytes = nodeBytes(table) + bucketBytes(table);
+    for (auto& keyValPair : table) {
+        if (keyValPair.second.use_count() == 1)
+            bytes += sharedBytes<typename Table::mapped_type::element_type>() + keyValPair.second->heapUsage();
+    }
+    return bytes;
+}
+
+// Estimated bytes of a deque: its 512 byte element blocks and the map
+// indexing them, which starts at eight entries.
+template <typename Deque>
+std::size_t dequeBytes(const Deque& deque) {
+    constexpr std::size_t kBlockBytes = 512;
+    std::size_t perBlock = std::max<std::size_t>(1, kBlockBytes / sizeof(typename Deque::value_type));
+    std::size_t blocks = deque.size() / perBlock + 1;
+    return blocks * perBlock * sizeof(typename Deque::value_type) + std::max<std::size_t>(8, blocks + 2) * sizeof(void*);
+}
+
+// Append-only sequence stored in chunks that never move once allocated,
+// so readers may index any element below the length published in their
+// state while the writer appends past it. Chunk k holds kFirstChunk << k
+// elements, so no chunk directory ever has to be reallocated.
+template <typename T>
+class AppendLog {
+public:
+    explicit AppendLog(std::pmr::memory_resource* resource) : m_resource(resource) {}
+
+    ~AppendLog() {
+        for (std::size_t i = 0; i < m_size; ++i)
+            (*this)[i].~T();
+        for (std::size_t chunk = 0; chunk < kMaxChunks && m_chunks[chunk]; ++chunk)
+            m_resource->deallocate(m_chunks[chunk], chunkCapacity(chunk) * sizeof(T), alignof(T));
+    }
+
+    AppendLog(const AppendLog& rhs) = delete;
+    AppendLog& operator=(const AppendLog& rhs) = delete;
+
+    // Construct an element at the end of the log. Writer only.
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        std::size_t chunk, offset;
+        locate(m_size, chunk, offset);
+        if (!m_chunks[chunk])
+            m_chunks[chunk] = static_cast<T*>(m_resource->allocate(chunkCapacity(chunk) * sizeof(T), alignof(T)));
+        T* element = new (m_chunks[chunk] + offset) T(std::forward<Args>(args)...);
+        ++m_size;
+        return *element;
+    }
+
+    // Number of elements appended. Writer only.
+    std::size_t size() const {
+        return m_size;
+    }
+
+    const T& operator[](std::size_t index) const {
+        std::size_t chunk, offset;
+        locate(index, chunk, offset);
+        return m_chunks[chunk][offset];
+    }
+
+    T& operator[](std::size_t index) {
+        std::size_t chunk, offset;
+        locate(index, chunk, offset);
+        return m_chunks[chunk][offset];
+    }
+
+    // Bytes allocated for the chunks holding the first count elements.
+    static std::size_t allocatedBytes(std::size_t count) {
+        std::size_t bytes = 0;
+        for (std::size_t chunk = 0; count > 0; ++chunk) {
+            bytes += chunkCapacity(chunk) * sizeof(T);
+            count -= std::min(count, chunkCapacity(chunk));
+        }
+        return bytes;
+    }
+
+private:
+    static constexpr std::size_t kFirstChunk = 64;
+    static constexpr std::size_t kMaxChunks = 40;
+
+    static constexpr std::size_t chunkCapacity(std::size_t chunk) {
+        return kFirstChunk << chunk;
+    }
+
+    static void locate(std::size_t index, std::size_t& chunk, std::size_t& offset) {
+        chunk = 0;
+        while (index >= chunkCapacity(chunk)) {
+            index -= chunkCapacity(chunk);
+            ++chunk;
+        }
+        offset = index;
+    }
+
+    std::pmr::memory_resource* m_resource;
+    std::size_t m_size = 0;
+    std::array<T*, kMaxChunks> m_chunks{};
+};
+
+// A policy written at the agency together with its commission plan.
+struct PolicyRecord {
+    PolicyRecord(const double faceValue, const CommissionPlan::CommPlanId planId)
+        : m_policy(faceValue), m_planId(planId), m_chainTail(kNoEntry) {}
+
+    PolicyRecord(const PolicyRecord& rhs)
+        : m_policy(rhs.m_policy), m_planId(rhs.m_planId), m_chainTail(rhs.m_chainTail.load()) {}
+
+    Policy m_policy;
+    CommissionPlan::CommPlanId m_planId;
+
+    // Chain log index of the last agent recorded for the policy, or kNoEntry.
+    // Moved forward by the writer while readers may follow it.
+    mutable std::atomic<std::uint32_t> m_chainTail;
+};
+
+// One agent in the chain of a policy, linked to the agent recorded before it.
+struct ChainEntry {
+    Agent::AgentId m_agentId;
+    std::uint32_t m_prev;
+};
+
+// Append-only stores of an agency. Every state of the agency shares them
+// and only reads up to the lengths published with it.
+struct Logs {
+    explicit Logs(std::pmr::memory_resource* resource)
+        : m_policies(resource), m_chains(resource), m_salesReceipts(resource) {}
 
-    // Store of all policies written at agency.
-    std::unordered_map<Policy::PolicyNo, std::shared_ptr<Policy>> m_policies;
+    // Store of all policies written at agency, in increasing policy number.
+    AppendLog<PolicyRecord> m_policies;
+
+    // Record of agents who sold each policy, linked per policy.
+    AppendLog<ChainEntry> m_chains;
 
     // Record of all  policies sold.
-    std::vector<Policy::PolicyNo> m_salesReceipts;
+    AppendLog<Policy::PolicyNo> m_salesReceipts;
+};
+
+} // namespace
+
+// One published, immutable version of the agency. Agents and plans are
+// rarely changed and are replaced copy-on-write; policies, agent chains
+// and receipts are appended to logs shared by every version.
+struct Agency::State {
+    using AgentTable = std::pmr::unordered_map<Agent::AgentId, std::shared_ptr<Agent>>;
+    using PlanTable = std::pmr::unordered_map<CommissionPlan::CommPlanId, std::shared_ptr<CommissionPlan>>;
+    using AgentChain = std::pmr::vector<Agent::AgentId>;
+
+    // Create an empty agency state allocating from given resource.
+    explicit State(std::pmr::memory_resource* resource);
+
+    // Resource all tables and objects of the agency are allocated from.
+    std::pmr::memory_resource* m_resource;
 
-    // Record of all agents who sold given policy. First agent is always selling agent.
-    std::unordered_map<Policy::PolicyNo, std::vector<Agent::AgentId>> m_policyAgents;
+    // Store of all agents working at agency.
+    std::shared_ptr<const AgentTable> m_agents;
+
+    // Store of all commission plans created at agency.
+    std::shared_ptr<const PlanTable> m_plans;
 
-    // Record of commission plan associated with given policy.
-    std::unordered_map<Policy::PolicyNo, CommissionPlan::CommPlanId> m_policyCommissionPlan;
+    // Policies, agent chains and receipts of the agency.
+    std::shared_ptr<Logs> m_logs;
 
-    std::shared_ptr<Agent> getAgent(const Agent::AgentId agentId);
+    // Lengths of the logs published with this state.
+    std::size_t m_policyCount = 0;
+    std::size_t m_chainCount = 0;
+    std::size_t m_receiptCount = 0;
+
+    // Return an allocator for objects shared between states.
+    std::pmr::polymorphic_allocator<std::byte> allocator() const;
+
+    std::shared_ptr<Agent> getAgent(const Agent::AgentId agentId) const;
 
     // Return true if agent is part of agency, otherwise falsel
-    bool validateAgent(const Agent::AgentId agentId);
+    bool validateAgent(const Agent::AgentId agentId) const;
 
     // Return a commission plan given its unique plan id.
-    std::shared_ptr<CommissionPlan> getCommissionPlan(const CommissionPlan::CommPlanId planId);
+    std::shared_ptr<CommissionPlan> getCommissionPlan(const CommissionPlan::CommPlanId planId) const;
 
     // Return true if commission plan is valid, otherwise false;
-    bool validateCommissionPlan(const CommissionPlan::CommPlanId planId);
+    bool validateCommissionPlan(const CommissionPlan::CommPlanId planId) const;
 
-    // Return insurance policy object given policy no.
-    std::shared_ptr<Policy> getPolicy(const Policy::PolicyNo policyNo);
+    // Return the record of given policy no, or nullptr.
+    const PolicyRecord* getPolicy(const Policy::PolicyNo policyNo) const;
 
     // Return true if policy no is valid, otherwise false.
-    bool validatePolicy(const Policy::PolicyNo policyNo);
+    bool validatePolicy(const Policy::PolicyNo policyNo) const;
+
+    // Collect the agents recorded for given policy, selling agent first.
+    void getPolicyAgents(const PolicyRecord& policy, AgentChain& agents) const;
+
+    // Append an agent to the chain of given policy. Writer only.
+    void appendPolicyAgent(const PolicyRecord& policy, const Agent::AgentId agentId);
 };
 
-Agency::Agency() : pImpl(std::make_unique<Agency::Impl>()) {}
+struct Agency::Impl {
+    // Destroys a state allocated from the agency's memory resource.
+    struct StateDeleter {
+        std::pmr::memory_resource* m_resource;
+        void operator()(const State* state) const;
+    };
+    using StatePtr = std::unique_ptr<State, StateDeleter>;
+
+    // A replaced state awaiting reclamation.
+    struct Retired {
+        std::uint64_t m_epoch;  // Epoch the state was retired in.
+        const State* m_state;
+        std::size_t m_bytes;    // Bytes freed along with the state.
+    };
+
+    explicit Impl(std::pmr::memory_resource* resource);
+
+    ~Impl();
+
+    Impl& operator=(const Impl& rhs) = delete;
+
+    // Resource every state, table and object of the agency comes from.
+    std::pmr::memory_resource* const m_resource;
+
+    // Serialises writers. Readers only take it once every slot is pinned.
+    std::mutex m_writeLock;
+
+    // Latest published state.
+    std::atomic<const State*> m_current;
+
+    // Global epoch, advanced each time a state is replaced.
+    std::atomic<std::uint64_t> m_epoch;
+
+    // Epoch pinned by each active reader, or kIdleSlot.
+    std::array<std::atomic<std::uint64_t>, kMaxReaders> m_readers;
+
+    // Epochs pinned by readers that found every slot busy.
+    // Only touched with m_writeLock held.
+    std::pmr::vector<std::uint64_t> m_overflowReaders;
+
+    // Replaced states awaiting reclamation. Only touched with m_writeLock held.
+    // States are retired in increasing epoch order, so the oldest is always
+    // at the front.
+    std::pmr::deque<Retired> m_retired;
+
+    // Oldest pinned epoch seen by the last reclaim. Every state retired
+    // before it has been freed. Only touched with m_writeLock held.
+    std::uint64_t m_reclaimedBelow;
+
+    // Sum of m_bytes over m_retired. Only touched with m_writeLock held.
+    std::size_t m_retiredStateBytes;
+
+    // Number of entries in m_retired, readable without the lock.
+    std::atomic<std::size_t> m_retiredCount;
+
+    // Bytes held by retired states and the bookkeeping above, readable
+    // without the lock.
+    std::atomic<std::size_t> m_retiredBytes;
+
+    // Pin the current epoch and return the reader slot holding it.
+    std::size_t pin(std::uint64_t& epoch, const State*& state);
+
+    // Release the pin held in given slot.
+    void unpin(const std::size_t slot, const std::uint64_t epoch);
+
+    // Return the latest state. Only valid with m_writeLock held.
+    const State& current() const;
+
+    // Allocate a copy of given state from the agency's resource.
+    StatePtr makeState(const State& from) const;
+
+    // Copy the latest state of rhs, taking rhs's writer lock. Tables,
+    // objects and logs of the copy are allocated from this agency's resource.
+    StatePtr copyFrom(Impl& rhs) const;
+
+    // Publish next as the latest state and retire the one it replaces.
+    // Must be called with m_writeLock held.
+    void publish(StatePtr next);
+
+    // Free retired states no pinned reader can still refer to.
+    // Must be called with m_writeLock held.
+    void reclaim();
+
+    // Reclaim unless a writer holds m_writeLock, in which case that writer
+    // reclaims when it publishes.
+    void tryReclaim();
+
+    // Refresh m_retiredBytes. Must be called with m_writeLock held.
+    void updateRetiredBytes();
+};
+
+Agency::Agency(std::pmr::memory_resource* resource)
+    : pImpl(std::make_unique<Agency::Impl>(resource)) {}
 
 Agency::~Agency() = default;
 
@@ -58,44 +361,72 @@ Agency::Agency(Agency&& rhs) = default;
 Agency& Agency::operator=(Agency&& rhs) = default;
 
 Agency::Agency(const Agency& rhs)
-    : pImpl(std::make_unique<Impl>(*rhs.pImpl)) {}
+    : pImpl(std::make_unique<Impl>(rhs.resource())) {
+    *this = rhs;
+}
 
 Agency& Agency::operator=(const Agency& rhs) {
-    *pImpl = *rhs.pImpl;
+    if (this == &rhs)
+        return *this;
+
+    auto next = pImpl->copyFrom(*rhs.pImpl);
+    std::lock_guard<std::mutex> guard(pImpl->m_writeLock);
+    pImpl->publish(std::move(next));
     return *this;
 }
 
+std::pmr::memory_resource* Agency::resource() const {
+    // Fixed for the lifetime of the agency, so no lock is needed.
+    return pImpl->m_resource;
+}
+
 // Public member implementation
 
 Agent::AgentId Agency::addAgent(const std::string name, float commission) {
-    auto agent = std::make_shared<Agent>(name, commission);
-    auto res = pImpl->m_agents.insert({agent->getUniqueId(), agent});
-    return res.first->second->getUniqueId();
+    std::lock_guard<std::mutex> guard(pImpl->m_writeLock);
+    auto next = pImpl->makeState(pImpl->current());
+    auto agent = std::allocate_shared<Agent>(next->allocator(), name, commission, next->m_resource);
+    auto res = copyOnWrite(next->m_agents, next->m_resource).insert({agent->getUniqueId(), agent});
+    auto agentId = res.first->second->getUniqueId();
+    pImpl->publish(std::move(next));
+    return agentId;
 }
 
 bool Agency::removeAgent(const Agent::AgentId agentId) {
-    return pImpl->m_agents.erase(agentId) != 0;
+    std::lock_guard<std::mutex> guard(pImpl->m_writeLock);
+    if (!pImpl->current().validateAgent(agentId))
+        return false;
+
+    auto next = pImpl->makeState(pImpl->current());
+    copyOnWrite(next->m_agents, next->m_resource).erase(agentId);
+    pImpl->publish(std::move(next));
+    return true;
 }
 
 void Agency::listAgents() const {
-    std::for_each(std::begin(pImpl->m_agents), std::end(pImpl->m_agents), [](auto& keyValPair) {
-        std::cout << "Agent ID: " << keyValPair.second->getUniqueId()
-            << "  Name: " << keyValPair.second->getName()
-            << "  Commission: " << keyValPair.second->getCommissionRate()
-            << std::endl;
-    });
+    snapshot().listAgents();
 }
 
 CommissionPlan::CommPlanId Agency::addCommissionPlan(const std::string& planName, std::initializer_list<float> rates) {
-    auto plan = std::make_shared<CommissionPlan>(planName, rates);
-    auto res = pImpl->m_plans.insert({plan->getUniqueId(), plan});
-    return res.first->second->getUniqueId();
+    std::lock_guard<std::mutex> guard(pImpl->m_writeLock);
+    auto next = pImpl->makeState(pImpl->current());
+    auto plan = std::allocate_shared<CommissionPlan>(next->allocator(), planName, rates, next->m_resource);
+    auto res = copyOnWrite(next->m_plans, next->m_resource).insert({plan->getUniqueId(), plan});
+    auto planId = res.first->second->getUniqueId();
+    pImpl->publish(std::move(next));
+    return planId;
 }
 
 void Agency::addNewCommissionRatesToPlan(const CommissionPlan::CommPlanId planId, std::initializer_list<float> rates) {
-    std::shared_ptr<CommissionPlan> commPlan = pImpl->getCommissionPlan(planId);
+    std::lock_guard<std::mutex> guard(pImpl->m_writeLock);
+    std::shared_ptr<CommissionPlan> commPlan = pImpl->current().getCommissionPlan(planId);
     if (commPlan) {
-        commPlan->addCommissions(rates);
+        // Readers may hold the existing plan, so amend a copy of it.
+        auto next = pImpl->makeState(pImpl->current());
+        auto newPlan = std::allocate_shared<CommissionPlan>(next->allocator(), *commPlan, next->m_resource);
+        newPlan->addCommissions(rates);
+        copyOnWrite(next->m_plans, next->m_resource)[planId] = newPlan;
+        pImpl->publish(std::move(next));
         return;
     }
 
@@ -103,20 +434,18 @@ void Agency::addNewCommissionRatesToPlan(const CommissionPlan::CommPlanId planId
 }
 
 void Agency::listCommissionPlans() const {
-    std::for_each(std::begin(pImpl->m_plans), std::end(pImpl->m_plans), [](auto& keyValPair) {
-        std::cout << "Commission Plan ID: " << keyValPair.second->getUniqueId()
-            << "    Name: " << keyValPair.second->getPlanName()
-            << std::endl;
-        keyValPair.second->listCommissionRates();
-    });
+    snapshot().listCommissionPlans();
 }
 
 Policy::PolicyNo Agency::createPolicy(const double faceValue, const CommissionPlan::CommPlanId commPlanId) {
-    if (pImpl->validateCommissionPlan(commPlanId)) {
-        auto policy = std::make_shared<Policy>(faceValue);
-        pImpl->m_policies.insert({policy->getUniqueId(), policy});
-        pImpl->m_policyCommissionPlan.insert({policy->getUniqueId(), commPlanId});
-        return policy->getUniqueId();
+    std::lock_guard<std::mutex> guard(pImpl->m_writeLock);
+    if (pImpl->current().validateCommissionPlan(commPlanId)) {
+        auto next = pImpl->makeState(pImpl->current());
+        // Policy numbers only increase, so the log stays sorted by number.
+        auto& record = next->m_logs->m_policies.emplace_back(faceValue, commPlanId);
+        next->m_policyCount = next->m_logs->m_policies.size();
+        pImpl->publish(std::move(next));
+        return record.m_policy.getUniqueId();
     }
 
     std::cout << "Invalid commission plan id specified: " << commPlanId << std::endl;
@@ -124,46 +453,138 @@ Policy::PolicyNo Agency::createPolicy(const double faceValue, const CommissionPl
 }
 
 void Agency::recordSellingAgent(const Policy::PolicyNo policy, Agent::AgentId agentId) {
-    if (!pImpl->validatePolicy(policy)) {
+    std::lock_guard<std::mutex> guard(pImpl->m_writeLock);
+    const PolicyRecord* record = pImpl->current().getPolicy(policy);
+    if (!record) {
         std::cout << "Invalid policy provided." << std::endl;
         return;
     }
-    if (!pImpl->validateAgent(agentId)) {
+    if (!pImpl->current().validateAgent(agentId)) {
         std::cout << "Invalid selling agent provided." << std::endl;
         return;
     }
-    pImpl->m_policyAgents[policy].push_back(agentId);
+    auto next = pImpl->makeState(pImpl->current());
+    next->appendPolicyAgent(*record, agentId);
+    pImpl->publish(std::move(next));
 }
 
 void Agency::recordSuperAgents(const Policy::PolicyNo policy, const std::initializer_list<Agent::AgentId>& agentIds) {
-    if (!pImpl->validatePolicy(policy)) {
+    std::lock_guard<std::mutex> guard(pImpl->m_writeLock);
+    const State& state = pImpl->current();
+    const PolicyRecord* record = state.getPolicy(policy);
+    if (!record) {
         std::cout << "Invalid policy provided." << std::endl;
         return;
     }
-    if (pImpl->m_policyAgents.find(policy) == pImpl->m_policyAgents.end()) {
+    if (record->m_chainTail.load() == kNoEntry) {
         std::cout << "No selling agent recorded. Please add a selling agent first." << std::endl;
         return;
     }
-    std::for_each(std::begin(agentIds), std::end(agentIds), [this, &policy](auto& agent) {
-        if (!pImpl->validateAgent(agent)) {
+    auto next = pImpl->makeState(state);
+    std::for_each(std::begin(agentIds), std::end(agentIds), [&state, &next, record](auto& agent) {
+        if (!state.validateAgent(agent)) {
             std::cout << "Super agent with id <" << agent << "> is invalid. Skipping." << std::endl;
         }
-        pImpl->m_policyAgents[policy].push_back((agent));
+        next->appendPolicyAgent(*record, agent);
     });
+    pImpl->publish(std::move(next));
 }
 
 void Agency::recordPolicySale(const Policy::PolicyNo policy) {
-    pImpl->m_salesReceipts.push_back(policy);
+    std::lock_guard<std::mutex> guard(pImpl->m_writeLock);
+    auto next = pImpl->makeState(pImpl->current());
+    next->m_logs->m_salesReceipts.emplace_back(policy);
+    next->m_receiptCount = next->m_logs->m_salesReceipts.size();
+    pImpl->publish(std::move(next));
     std::cout << "Policy no " << policy << " sale recorded." << std::endl;
 }
 
-void Agency::calculateCommissions() {
-    for (auto &policyNo : pImpl->m_salesReceipts) {
-        auto policy = pImpl->getPolicy(policyNo);
-        auto commPlan = pImpl->getCommissionPlan(pImpl->m_policyCommissionPlan[policyNo]);
+void Agency::calculateCommissions(std::pmr::memory_resource* scratch) {
+    snapshot().calculateCommissions(scratch);
+}
+
+Agency::MemoryUsage Agency::memoryUsage() const {
+    return snapshot().memoryUsage();
+}
+
+std::size_t Agency::retiredStates() const {
+    return pImpl->m_retiredCount.load();
+}
+
+std::size_t Agency::MemoryUsage::total() const {
+    return agents + plans + policies + chains + receipts + hashOverhead + bookkeeping + retired;
+}
+
+Agency::Snapshot Agency::snapshot() const {
+    // Free states left behind by snapshots released since the last write.
+    pImpl->tryReclaim();
+
+    std::uint64_t epoch = kIdleSlot;
+    const State* state = nullptr;
+    auto slot = pImpl->pin(epoch, state);
+    return Snapshot(pImpl.get(), slot, epoch, state);
+}
+
+// Snapshot implementation
+
+Agency::Snapshot::Snapshot(Impl* owner, std::size_t slot, std::uint64_t epoch, const State* state)
+    : m_owner(owner), m_slot(slot), m_epoch(epoch), m_state(state) {}
+
+Agency::Snapshot::~Snapshot() {
+    if (m_owner)
+        m_owner->unpin(m_slot, m_epoch);
+}
+
+Agency::Snapshot::Snapshot(Snapshot&& rhs)
+    : m_owner(rhs.m_owner), m_slot(rhs.m_slot), m_epoch(rhs.m_epoch), m_state(rhs.m_state) {
+    rhs.m_owner = nullptr;
+    rhs.m_state = nullptr;
+}
+
+std::uint64_t Agency::Snapshot::epoch() const {
+    return m_epoch;
+}
+
+void Agency::Snapshot::listAgents() const {
+    std::for_each(std::begin(*m_state->m_agents), std::end(*m_state->m_agents), [](auto& keyValPair) {
+        std::cout << "Agent ID: " << keyValPair.second->getUniqueId()
+            << "  Name: " << keyValPair.second->getName()
+            << "  Commission: " << keyValPair.second->getCommissionRate()
+            << std::endl;
+    });
+}
+
+void Agency::Snapshot::listCommissionPlans() const {
+    std::for_each(std::begin(*m_state->m_plans), std::end(*m_state->m_plans), [](auto& keyValPair) {
+        std::cout << "Commission Plan ID: " << keyValPair.second->getUniqueId()
+            << "    Name: " << keyValPair.second->getPlanName()
+            << std::endl;
+        keyValPair.second->listCommissionRates();
+    });
+}
+
+void Agency::Snapshot::calculateCommissions(std::pmr::memory_resource* scratch) const {
+    // Without a caller supplied resource, scratch buffers come from an arena
+    // that is released in one shot when the run completes. It draws on the
+    // default resource, as the agency's own need not be safe to share with
+    // a writer on another thread.
+    std::pmr::monotonic_buffer_resource arena(std::pmr::get_default_resource());
+    if (!scratch)
+        scratch = &arena;
+
+    // Agents recorded for the policy being reported, selling agent first.
+    State::AgentChain policyAgents(scratch);
+
+    const auto& receipts = m_state->m_logs->m_salesReceipts;
+    for (std::size_t receipt = 0; receipt < m_state->m_receiptCount; ++receipt) {
+        auto policyNo = receipts[receipt];
+        auto record = m_state->getPolicy(policyNo);
+        auto commPlan = m_state->getCommissionPlan(record->m_planId);
+        const Policy& policy = record->m_policy;
+        m_state->getPolicyAgents(*record, policyAgents);
 
         std::cout << "Commissions for policy plan no: " << policyNo
-            << "    Face value: " << policy->getFaceAmount()
+            << "    Face value: " << policy.getFaceAmount()
             << std::endl;
 
         // Sanity check for valid commission rates.
@@ -172,11 +593,11 @@ void Agency::calculateCommissions() {
             return;
         }
 
-        for (std::size_t i = 0; i < commPlan->size() || i < pImpl->m_policyAgents[policyNo].size(); ++i) {
-            if (i < pImpl->m_policyAgents[policyNo].size()) {
-                auto agent = pImpl->getAgent(pImpl->m_policyAgents[policyNo][i]);
+        for (std::size_t i = 0; i < commPlan->size() || i < policyAgents.size(); ++i) {
+            if (i < policyAgents.size()) {
+                auto agent = m_state->getAgent(policyAgents[i]);
                 float rate = i < commPlan->size() ? (*commPlan)[i] : 0;
-                float totalCommissions = rate * agent->getCommissionRate() * policy->getFaceAmount();
+                float totalCommissions = rate * agent->getCommissionRate() * policy.getFaceAmount();
                 if (i == 0) {
                     std::cout << "Selling agent commission <" << agent->getName()
                                     << "> : " << totalCommissions << std::endl;
@@ -190,37 +611,263 @@ void Agency::calculateCommissions() {
     }
 }
 
+Agency::MemoryUsage Agency::Snapshot::memoryUsage() const {
+    MemoryUsage usage;
+
+    const auto& agents = *m_state->m_agents;
+    usage.agents += nodeBytes(agents);
+    for (auto& keyValPair : agents)
+        usage.agents += sharedBytes<Agent>() + keyValPair.second->heapUsage();
+
+    const auto& plans = *m_state->m_plans;
+    usage.plans += nodeBytes(plans);
+    for (auto& keyValPair : plans)
+        usage.plans += sharedBytes<CommissionPlan>() + keyValPair.second->heapUsage();
+
+    usage.policies += AppendLog<PolicyRecord>::allocatedBytes(m_state->m_policyCount);
+    usage.chains += AppendLog<ChainEntry>::allocatedBytes(m_state->m_chainCount);
+    usage.receipts += AppendLog<Policy::PolicyNo>::allocatedBytes(m_state->m_receiptCount);
+
+    usage.hashOverhead += bucketBytes(agents) + bucketBytes(plans);
+
+    usage.bookkeeping += sizeof(State) + sharedBytes<Logs>();
+    usage.retired += m_owner->m_retiredBytes.load();
+
+    return usage;
+}
+
 // Private member implementation
 
-std::shared_ptr<Agent> Agency::Impl::getAgent(const Agent::AgentId agentId) {
-    auto agent_iter = Agency::Impl::m_agents.find(agentId);
-    if (agent_iter != Agency::Impl::m_agents.end())
+Agency::Impl::Impl(std::pmr::memory_resource* resource)
+    : m_resource(resource), m_current(nullptr), m_epoch(1), m_overflowReaders(resource),
+      m_retired(resource), m_reclaimedBelow(0), m_retiredStateBytes(0), m_retiredCount(0), m_retiredBytes(0) {
+    for (auto& reader : m_readers)
+        reader.store(kIdleSlot);
+    m_current.store(makeState(State(resource)).release());
+}
+
+Agency::Impl::~Impl() {
+    // No snapshot may outlive its agency, so nothing is pinned here.
+    StateDeleter destroy{m_resource};
+    destroy(m_current.load());
+    for (auto& retired : m_retired)
+        destroy(retired.m_state);
+}
+
+void Agency::Impl::StateDeleter::operator()(const State* state) const {
+    std::pmr::polymorphic_allocator<State> alloc(m_resource);
+    state->~State();
+    alloc.deallocate(const_cast<State*>(state), 1);
+}
+
+std::size_t Agency::Impl::pin(std::uint64_t& epoch, const State*& state) {
+    for (std::size_t slot = 0; slot < kMaxReaders; ++slot) {
+        std::uint64_t idle = kIdleSlot;
+        epoch = m_epoch.load();
+        if (!m_readers[slot].compare_exchange_strong(idle, epoch))
+            continue;
+
+        // Re-announce until the epoch is stable. A writer that retired a
+        // state in an older epoch has then already published its successor.
+        while (m_epoch.load() != epoch) {
+            epoch = m_epoch.load();
+            m_readers[slot].store(epoch);
+        }
+        state = m_current.load();
+        return slot;
+    }
+
+    // Every slot is pinned. Record the epoch under the writer lock instead;
+    // no state can be replaced while it is held.
+    std::lock_guard<std::mutex> guard(m_writeLock);
+    epoch = m_epoch.load();
+    state = m_current.load();
+    m_overflowReaders.push_back(epoch);
+    updateRetiredBytes();
+    return kOverflowSlot;
+}
+
+void Agency::Impl::unpin(const std::size_t slot, const std::uint64_t epoch) {
+    if (slot == kOverflowSlot) {
+        std::lock_guard<std::mutex> guard(m_writeLock);
+        m_overflowReaders.erase(std::find(std::begin(m_overflowReaders), std::end(m_overflowReaders), epoch));
+        reclaim();
+        return;
+    }
+
+    m_readers[slot].store(kIdleSlot);
+    tryReclaim();
+}
+
+const Agency::State& Agency::Impl::current() const {
+    return *m_current.load();
+}
+
+Agency::Impl::StatePtr Agency::Impl::makeState(const State& from) const {
+    std::pmr::polymorphic_allocator<State> alloc(m_resource);
+    State* state = alloc.allocate(1);
+    new (state) State(from);
+    return StatePtr(state, StateDeleter{m_resource});
+}
+
+Agency::Impl::StatePtr Agency::Impl::copyFrom(Impl& rhs) const {
+    std::lock_guard<std::mutex> guard(rhs.m_writeLock);
+    const State& source = rhs.current();
+    auto copy = makeState(State(m_resource));
+    auto alloc = copy->allocator();
+
+    auto agents = std::allocate_shared<State::AgentTable>(alloc);
+    for (auto& keyValPair : *source.m_agents)
+        agents->insert({keyValPair.first, std::allocate_shared<Agent>(alloc, *keyValPair.second, m_resource)});
+    copy->m_agents = agents;
+
+    auto plans = std::allocate_shared<State::PlanTable>(alloc);
+    for (auto& keyValPair : *source.m_plans)
+        plans->insert({keyValPair.first, std::allocate_shared<CommissionPlan>(alloc, *keyValPair.second, m_resource)});
+    copy->m_plans = plans;
+
+    for (std::size_t i = 0; i < source.m_policyCount; ++i)
+        copy->m_logs->m_policies.emplace_back(source.m_logs->m_policies[i]);
+    for (std::size_t i = 0; i < source.m_chainCount; ++i)
+        copy->m_logs->m_chains.emplace_back(source.m_logs->m_chains[i]);
+    for (std::size_t i = 0; i < source.m_receiptCount; ++i)
+        copy->m_logs->m_salesReceipts.emplace_back(source.m_logs->m_salesReceipts[i]);
+    copy->m_policyCount = source.m_policyCount;
+    copy->m_chainCount = source.m_chainCount;
+    copy->m_receiptCount = source.m_receiptCount;
+    return copy;
+}
+
+void Agency::Impl::publish(StatePtr next) {
+    const State* replaced = m_current.exchange(next.release());
+    const State& successor = current();
+
+    // Count what only the replaced state holds, so that each table or log
+    // is charged to the last state referring to it.
+    std::size_t bytes = sizeof(State);
+    if (replaced->m_agents != successor.m_agents)
+        bytes += retiredTableBytes(*replaced->m_agents);
+    if (replaced->m_plans != successor.m_plans)
+        bytes += retiredTableBytes(*replaced->m_plans);
+    if (replaced->m_logs != successor.m_logs) {
+        bytes += sharedBytes<Logs>()
+            + AppendLog<PolicyRecord>::allocatedBytes(replaced->m_policyCount)
+            + AppendLog<ChainEntry>::allocatedBytes(replaced->m_chainCount)
+            + AppendLog<Policy::PolicyNo>::allocatedBytes(replaced->m_receiptCount);
+    }
+
+    m_retired.push_back({m_epoch.fetch_add(1), replaced, bytes});
+    m_retiredStateBytes += bytes;
+    m_retiredCount.store(m_retired.size());
+    reclaim();
+}
+
+void Agency::Impl::reclaim() {
+    // Oldest epoch any reader may still be using.
+    std::uint64_t oldest = m_epoch.load();
+    for (auto& reader : m_readers) {
+        auto epoch = reader.load();
+        if (epoch != kIdleSlot && epoch < oldest)
+            oldest = epoch;
+    }
+    for (auto epoch : m_overflowReaders)
+        oldest = std::min(oldest, epoch);
+
+    // States retired since the last reclaim were tagged with an epoch no
+    // older than the one seen then, so nothing new can be freed unless the
+    // oldest pinned epoch has moved.
+    if (oldest != m_reclaimedBelow) {
+        m_reclaimedBelow = oldest;
+        StateDeleter destroy{m_resource};
+        while (!m_retired.empty() && m_retired.front().m_epoch < oldest) {
+            m_retiredStateBytes -= m_retired.front().m_bytes;
+            destroy(m_retired.front().m_state);
+            m_retired.pop_front();
+        }
+    }
+    m_retiredCount.store(m_retired.size());
+    updateRetiredBytes();
+}
+
+void Agency::Impl::tryReclaim() {
+    if (m_retiredCount.load() == 0)
+        return;
+
+    std::unique_lock<std::mutex> guard(m_writeLock, std::try_to_lock);
+    if (guard)
+        reclaim();
+}
+
+void Agency::Impl::updateRetiredBytes() {
+    m_retiredBytes.store(m_retiredStateBytes
+        + dequeBytes(m_retired)
+        + m_overflowReaders.capacity() * sizeof(std::uint64_t));
+}
+
+Agency::State::State(std::pmr::memory_resource* resource)
+    : m_resource(resource),
+      m_agents(std::allocate_shared<AgentTable>(allocator())),
+      m_plans(std::allocate_shared<PlanTable>(allocator())),
+      m_logs(std::allocate_shared<Logs>(allocator(), resource)) {}
+
+std::pmr::polymorphic_allocator<std::byte> Agency::State::allocator() const {
+    return std::pmr::polymorphic_allocator<std::byte>(m_resource);
+}
+
+std::shared_ptr<Agent> Agency::State::getAgent(const Agent::AgentId agentId) const {
+    auto agent_iter = m_agents->find(agentId);
+    if (agent_iter != m_agents->end())
         return agent_iter->second;
     return nullptr;
 }
 
-bool Agency::Impl::validateAgent(const Agent::AgentId agentId) {
-    return Agency::Impl::m_agents.find(agentId) != Agency::Impl::m_agents.end();
+bool Agency::State::validateAgent(const Agent::AgentId agentId) const {
+    return m_agents->find(agentId) != m_agents->end();
 }
 
-std::shared_ptr<CommissionPlan> Agency::Impl::getCommissionPlan(const CommissionPlan::CommPlanId planId) {
-    auto plan_iter = Agency::Impl::m_plans.find(planId);
-    if (plan_iter != Agency::Impl::m_plans.end())
+std::shared_ptr<CommissionPlan> Agency::State::getCommissionPlan(const CommissionPlan::CommPlanId planId) const {
+    auto plan_iter = m_plans->find(planId);
+    if (plan_iter != m_plans->end())
         return plan_iter->second;
     return nullptr;
 }
 
-bool Agency::Impl::validateCommissionPlan(const CommissionPlan::CommPlanId planId) {
-    return Agency::Impl::m_plans.find(planId) != Agency::Impl::m_plans.end();
+bool Agency::State::validateCommissionPlan(const CommissionPlan::CommPlanId planId) const {
+    return m_plans->find(planId) != m_plans->end();
 }
 
-std::shared_ptr<Policy> Agency::Impl::getPolicy(const Policy::PolicyNo policyNo) {
-    auto agent_iter = Agency::Impl::m_policies.find(policyNo);
-    if (agent_iter != Agency::Impl::m_policies.end())
-        return agent_iter->second;
+const PolicyRecord* Agency::State::getPolicy(const Policy::PolicyNo policyNo) const {
+    // Binary search, as policies are logged in increasing policy number.
+    std::size_t low = 0;
+    std::size_t high = m_policyCount;
+    while (low < high) {
+        std::size_t mid = low + (high - low) / 2;
+        if (m_logs->m_policies[mid].m_policy.getUniqueId() < policyNo)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low < m_policyCount && m_logs->m_policies[low].m_policy.getUniqueId() == policyNo)
+        return &m_logs->m_policies[low];
     return nullptr;
 }
 
-bool Agency::Impl::validatePolicy(const Policy::PolicyNo policyNo) {
-    return Agency::Impl::m_policies.find(policyNo) != Agency::Impl::m_policies.end();
+bool Agency::State::validatePolicy(const Policy::PolicyNo policyNo) const {
+    return getPolicy(policyNo) != nullptr;
+}
+
+void Agency::State::getPolicyAgents(const PolicyRecord& policy, AgentChain& agents) const {
+    agents.clear();
+    // Walk back from the newest entry, skipping any appended after this state.
+    for (auto entry = policy.m_chainTail.load(); entry != kNoEntry; entry = m_logs->m_chains[entry].m_prev) {
+        if (entry < m_chainCount)
+            agents.push_back(m_logs->m_chains[entry].m_agentId);
+    }
+    std::reverse(std::begin(agents), std::end(agents));
+}
+
+void Agency::State::appendPolicyAgent(const PolicyRecord& policy, const Agent::AgentId agentId) {
+    m_logs->m_chains.emplace_back(ChainEntry{agentId, policy.m_chainTail.load()});
+    m_chainCount = m_logs->m_chains.size();
+    policy.m_chainTail.store(static_cast<std::uint32_t>(m_chainCount - 1));
 }
@@ -8,6 +8,19 @@
  *  Each agency can add a list of insurance agents.
  *  Each agency can create one or more commission plans.
  *  Each agency stores a list of policies sold.
+ *
+ *  Writers (add*, create*, record*) are serialised among themselves and
+ *  publish a new state on each change. Policies, agent chains and sales
+ *  receipts are appended to logs shared by every state, so those writes
+ *  cost the same however large the agency grows; agents and plans are
+ *  copied on write. Readers pin a Snapshot of the latest published state
+ *  without taking a lock, so reports can run while policies are still
+ *  being written. Replaced states are reclaimed once no pinned snapshot
+ *  can still refer to them.
+ *
+ *  All states, agents, plans, policies and the tables and logs holding
+ *  them are allocated from the memory resource the agency is constructed
+ *  with.
  */
 
 #ifndef AGENCY_H_
@@ -16,7 +29,10 @@
 #include "Agent.h"
 #include "CommissionPlan.h"
 #include "Policy.h"
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <memory_resource>
 
 // Agency interface
 //class IAgency {
@@ -38,8 +54,29 @@
 
 class Agency {
 public:
-    // Default constructor
-    Agency();
+    class Snapshot;
+
+    // Estimated bytes held by each structure of an agency. Computed from
+    // the container layout, so allocator bookkeeping is not included.
+    struct MemoryUsage {
+        std::size_t agents = 0;        // Agent objects and their names.
+        std::size_t plans = 0;         // Commission plans, names and rates.
+        std::size_t policies = 0;      // Policy objects and their plan ids.
+        std::size_t chains = 0;        // Selling and super agents per policy.
+        std::size_t receipts = 0;      // Record of policies sold.
+        std::size_t hashOverhead = 0;  // Hash table objects and bucket arrays.
+        std::size_t bookkeeping = 0;   // The published state and its log headers.
+        std::size_t retired = 0;       // Retired states and the tables only they still hold.
+
+        std::size_t total() const;
+    };
+
+    // Construct an agency allocating from the given memory resource.
+    // The resource must outlive the agency. Every write allocates a small
+    // state and changes to agents or plans copy their table, so resources
+    // that never reuse freed memory, such as monotonic_buffer_resource,
+    // grow with each write. Keep those for calculateCommissions scratch.
+    explicit Agency(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
     // Default destructor
     ~Agency();
@@ -50,12 +87,15 @@ public:
     // Move operator=
     Agency& operator=(Agency&& rhs);
 
-    // Copy constructor
+    // Copy constructor. The copy allocates from rhs's memory resource.
     Agency(const Agency& rhs);
 
-    // Copy operator=
+    // Copy operator=. Keeps this agency's memory resource and copies rhs into it.
     Agency& operator=(const Agency& rhs);
 
+    // Return the memory resource the agency allocates from.
+    std::pmr::memory_resource* resource() const;
+
     // Add an agent to agency.
     Agent::AgentId addAgent(const std::string name, float commission);
 
@@ -92,11 +132,66 @@ public:
     // Calculate agent commissions for all policies sold at the agency.
     // We assume there are commission rates for each agent. If not, the
     //corresponding agents will have zero commissions for this policy.
-    void calculateCommissions();
+    // Scratch buffers of the run come from scratch when given, otherwise
+    // from an arena that is released when the run completes.
+    void calculateCommissions(std::pmr::memory_resource* scratch = nullptr);
+
+    // Report the memory held by the agency, broken down by structure.
+    MemoryUsage memoryUsage() const;
+
+    // Return the number of replaced states not yet reclaimed.
+    std::size_t retiredStates() const;
+
+    // Pin a consistent read-only view of the agency as of the latest write.
+    // Writers never wait on the returned snapshot. Does not block while
+    // fewer than 64 snapshots are pinned on the agency; beyond that the
+    // pin is recorded under the writer lock, so it waits for any write in
+    // progress. The snapshot must not outlive the agency.
+    Snapshot snapshot() const;
 
 private:
     struct Impl;
+    struct State;
     std::unique_ptr<Impl> pImpl;
 };
 
+// A pinned epoch of an agency. Changes made to the agency after the
+// snapshot was taken are not visible through it.
+class Agency::Snapshot {
+public:
+    ~Snapshot();
+
+    Snapshot(Snapshot&& rhs);
+    Snapshot& operator=(Snapshot&& rhs) = delete;
+
+    Snapshot(const Snapshot& rhs) = delete;
+    Snapshot& operator=(const Snapshot& rhs) = delete;
+
+    // Epoch of the agency this snapshot is pinned to.
+    std::uint64_t epoch() const;
+
+    // List all agents in the snapshot.
+    void listAgents() const;
+
+    // List all the commission plans in the snapshot.
+    void listCommissionPlans() const;
+
+    // Calculate agent commissions for all policies sold as of the snapshot.
+    void calculateCommissions(std::pmr::memory_resource* scratch = nullptr) const;
+
+    // Report the memory published in this snapshot, broken down by structure.
+    // The retired field is agency-wide, as of the call, not per snapshot.
+    MemoryUsage memoryUsage() const;
+
+private:
+    friend class Agency;
+
+    Snapshot(Impl* owner, std::size_t slot, std::uint64_t epoch, const State* state);
+
+    Impl* m_owner;
+    std::size_t m_slot;
+    std::uint64_t m_epoch;
+    const State* m_state;
+};
+
 #endif /* AGENCY_H_ */
@@ -10,8 +10,8 @@
 
 Agent::AgentId Agent::agentId = 1000;
 
-Agent::Agent(const std::string& name, const float commRate)
-    : m_commissionRate(commRate), m_agentName(name),
+Agent::Agent(const std::string& name, const float commRate, std::pmr::memory_resource* resource)
+    : m_commissionRate(commRate), m_agentName(name, resource),
       m_uniqueAgentId(++Agent::agentId) {
 
     std::cout << "Agent <" << std::left << name
@@ -19,6 +19,10 @@ Agent::Agent(const std::string& name, const float commRate)
         << " added." << std::endl;
 }
 
+Agent::Agent(const Agent& rhs, std::pmr::memory_resource* resource)
+    : m_commissionRate(rhs.m_commissionRate), m_agentName(rhs.m_agentName, resource),
+      m_uniqueAgentId(rhs.m_uniqueAgentId) {}
+
 Agent::~Agent() = default;
 
 Agent::Agent(Agent&& rhs) = default;
@@ -37,5 +41,12 @@ Agent::AgentId Agent::getUniqueId() const {
 }
 
 std::string Agent::getName() const {
-    return m_agentName;
+    return std::string(m_agentName);
+}
+
+std::size_t Agent::heapUsage() const {
+    // Names short enough for the small string buffer own no heap memory.
+    if (m_agentName.capacity() <= std::pmr::string().capacity())
+        return 0;
+    return m_agentName.capacity() + 1;
 }
@@ -12,8 +12,11 @@
 #ifndef AGENT_H_
 #define AGENT_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <memory_resource>
+#include <string>
 
 class Agent {
 public:
@@ -21,7 +24,11 @@ public:
     // Class variable to generate a unique id for each agent instance.
     static AgentId agentId;
 
-    Agent(const std::string&, const float);
+    Agent(const std::string&, const float,
+          std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // Copy an agent, keeping its unique id, into storage from the given resource.
+    Agent(const Agent& rhs, std::pmr::memory_resource* resource);
 
     ~Agent();
 
@@ -36,9 +43,12 @@ public:
 
     std::string getName() const;
 
+    // Return the heap bytes owned by this agent, excluding the object itself.
+    std::size_t heapUsage() const;
+
 private:
     float m_commissionRate;
-    std::string m_agentName;
+    std::pmr::string m_agentName;
     AgentId m_uniqueAgentId;
 };
 
@@ -10,16 +10,23 @@
 
 CommissionPlan::CommPlanId CommissionPlan::planId = 5000;
 
-CommissionPlan::CommissionPlan(const std::string& name)
-    : m_planName(name), m_uniquePlanId(++CommissionPlan::planId) {}
+CommissionPlan::CommissionPlan(const std::string& name, std::pmr::memory_resource* resource)
+    : m_planName(name, resource), m_uniquePlanId(++CommissionPlan::planId),
+      m_commissionPlanRates(resource) {}
 
-CommissionPlan::CommissionPlan(const std::string& name, std::initializer_list<float> rates)
-    : m_planName(name), m_uniquePlanId(++CommissionPlan::planId) {
+CommissionPlan::CommissionPlan(const std::string& name, std::initializer_list<float> rates,
+                               std::pmr::memory_resource* resource)
+    : m_planName(name, resource), m_uniquePlanId(++CommissionPlan::planId),
+      m_commissionPlanRates(resource) {
     for (auto rate : rates) {
         m_commissionPlanRates.push_back(rate);
     }
 }
 
+CommissionPlan::CommissionPlan(const CommissionPlan& rhs, std::pmr::memory_resource* resource)
+    : m_planName(rhs.m_planName, resource), m_uniquePlanId(rhs.m_uniquePlanId),
+      m_commissionPlanRates(rhs.m_commissionPlanRates, resource) {}
+
 CommissionPlan::~CommissionPlan() = default;
 
 float CommissionPlan::operator[](std::size_t index) {
@@ -60,9 +67,17 @@ void CommissionPlan::listCommissionRates() const {
 }
 
 std::string CommissionPlan::getPlanName() const {
-    return m_planName;
+    return std::string(m_planName);
 }
 
 CommissionPlan::CommPlanId CommissionPlan::getUniqueId() const {
     return m_uniquePlanId;
 }
+
+std::size_t CommissionPlan::heapUsage() const {
+    std::size_t bytes = m_commissionPlanRates.capacity() * sizeof(float);
+    // Names short enough for the small string buffer own no heap memory.
+    if (m_planName.capacity() > std::pmr::string().capacity())
+        bytes += m_planName.capacity() + 1;
+    return bytes;
+}
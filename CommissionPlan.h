@@ -15,8 +15,10 @@
 #ifndef COMMISSIONPLAN_H_
 #define COMMISSIONPLAN_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <initializer_list>
+#include <memory_resource>
 #include <string>
 #include <vector>
 
@@ -26,9 +28,14 @@ public:
     // Class variable to generate a unique id for each commission plan instance.
     static CommPlanId planId;
 
-    CommissionPlan(const std::string& name);
+    CommissionPlan(const std::string& name,
+                   std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
-    CommissionPlan(const std::string& planName, std::initializer_list<float> rates);
+    CommissionPlan(const std::string& planName, std::initializer_list<float> rates,
+                   std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // Copy a plan, keeping its unique id, into storage from the given resource.
+    CommissionPlan(const CommissionPlan& rhs, std::pmr::memory_resource* resource);
 
     // Subscript operator to efficiently return the rate per agent.
     float operator[](std::size_t);
@@ -55,10 +62,13 @@ public:
 
     CommPlanId getUniqueId() const;
 
+    // Return the heap bytes owned by this plan, excluding the object itself.
+    std::size_t heapUsage() const;
+
 private:
-    std::string m_planName;
+    std::pmr::string m_planName;
     CommPlanId m_uniquePlanId;
-    std::vector<float> m_commissionPlanRates;
+    std::pmr::vector<float> m_commissionPlanRates;
 };
 
 #endif /* COMMISSIONPLAN_H_ */
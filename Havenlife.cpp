@@ -6,6 +6,26 @@
  */
 
 #include "Agency.h"
+#include <sstream>
+#include <string>
+
+// Return what the given report writes to std::cout.
+template <typename Report>
+std::string capture(Report report) {
+    std::ostringstream out;
+    auto* console = std::cout.rdbuf(out.rdbuf());
+    report();
+    std::cout.rdbuf(console);
+    return out.str();
+}
+
+// Return true if the memory breakdowns agree, ignoring retired states.
+bool sameLayout(const Agency::MemoryUsage& lhs, const Agency::MemoryUsage& rhs) {
+    return lhs.agents == rhs.agents && lhs.plans == rhs.plans
+        && lhs.policies == rhs.policies && lhs.chains == rhs.chains
+        && lhs.receipts == rhs.receipts && lhs.hashOverhead == rhs.hashOverhead
+        && lhs.bookkeeping == rhs.bookkeeping;
+}
 
 int main() {
 
@@ -57,8 +77,50 @@ int main() {
     agency->recordPolicySale(policy3);
 
     std::cout << std::endl;
-    // Calculate agent commissions for each policy sold.
-    agency->calculateCommissions();
+    // Calculate agent commissions for each policy sold, from a pinned
+    // snapshot so further sales could be recorded while the report runs.
+    auto report = std::make_unique<Agency::Snapshot>(agency->snapshot());
+    report->calculateCommissions();
+
+    // Report memory held by the agency.
+    auto usage = report->memoryUsage();
+    std::cout << "Memory usage (bytes): agents " << usage.agents
+        << ", plans " << usage.plans
+        << ", policies " << usage.policies
+        << ", chains " << usage.chains
+        << ", receipts " << usage.receipts
+        << ", hash overhead " << usage.hashOverhead
+        << ", bookkeeping " << usage.bookkeeping
+        << ", retired " << usage.retired
+        << ", total " << usage.total()
+        << std::endl << std::endl;
+
+    // Keep writing while the report is pinned. None of it may show through
+    // the snapshot, including a super agent added to a policy it reports.
+    auto pinnedReport = capture([&report] {
+        report->calculateCommissions();
+        report->listAgents();
+    });
+    auto agentKim = agency->addAgent("Kim", 0.03);
+    auto policy4 = agency->createPolicy(50000, commPlanB);
+    agency->recordSellingAgent(policy4, agentKim);
+    agency->recordSuperAgents(policy4, {agentBob});
+    agency->recordSuperAgents(policy3, {agentKim});
+    agency->recordPolicySale(policy4);
+    bool unchanged = capture([&report] {
+        report->calculateCommissions();
+        report->listAgents();
+    }) == pinnedReport && sameLayout(report->memoryUsage(), usage);
+
+    // Releasing the only snapshot frees every state retired while it was pinned.
+    report.reset();
+    bool reclaimed = agency->retiredStates() == 0;
+
+    std::cout << std::endl << "Snapshot unchanged by later writes: " << (unchanged ? "yes" : "NO")
+        << std::endl << "Retired states reclaimed on release: " << (reclaimed ? "yes" : "NO")
+        << std::endl << std::endl;
+    if (!unchanged || !reclaimed)
+        return 1;
 
     std::cout << "Complete!" << std::endl;
     return 0;